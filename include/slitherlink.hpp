@@ -1,6 +1,8 @@
 #ifndef SLITHERLINK_HPP
 #define SLITHERLINK_HPP
 
+#include <atomic>
+#include <random>
 #include <utility>
 #include <string>
 #include <vector>
@@ -25,18 +27,80 @@ enum class Number {
     THREE = 3,
 };
 
+enum class RuleTier {
+    CHEAP,
+    EXPENSIVE,
+};
+
+enum class VarOrder {
+    FIRST,
+    LAST,
+    MOST_DETERMINED,
+};
+
+enum class Polarity {
+    OUTER_FIRST,
+    INNER_FIRST,
+    RANDOM,
+};
+
+/* Branching configuration of a search. A nonzero seed breaks ties of MOST_DETERMINED randomly and drives RANDOM
+    polarity. A nonzero restart_base restarts the search after restart_base * luby(n) nodes in the n-th run. */
+struct SearchConfig {
+    VarOrder order = VarOrder::FIRST;
+    Polarity polarity = Polarity::OUTER_FIRST;
+    unsigned seed = 0;
+    long restart_base = 0;
+};
+
+struct UnsatCache;
+
 class Slitherlink {
 public:
     Slitherlink(const std::vector<std::vector<int>> &grid);
     Slitherlink(const std::vector<std::string> &grid);
 
     bool solve(void);
+    bool solve_portfolio(int n_workers, bool share_unsat = true);
     void print_solution(void);
 
 private:
+    using Rule = bool (Slitherlink::*)(std::vector<std::vector<Region>> &region, bool &changed);
+
+    /* A propagation rule with its scheduling tier and runtime statistics. */
+    struct RuleStat {
+        Rule rule;
+        RuleTier tier;
+        long passes;
+        long fires;
+    };
+
+    /* A cheap rule is demoted once it has run this many passes and fired in less than 1 / DEMOTE_FIRE_RATIO of them. */
+    static constexpr long DEMOTE_MIN_PASSES = 256;
+    static constexpr long DEMOTE_FIRE_RATIO = 32;
+
+    /* The unsat cache stops growing once its states take about this many bytes. */
+    static constexpr std::size_t UNSAT_CACHE_MAX_BYTES = 64 << 20;
+
+    static SearchConfig portfolio_config(int idx);
+
+    void init_rules(void);
     bool solve_helper(const std::vector<std::vector<Region>> &region);
+    std::pair<int, int> pick_branch(const std::vector<std::vector<Region>> &region);
+    Region pick_polarity(void);
+    std::string region_key(const std::vector<std::vector<Region>> &region);
     bool apply_heuristics(std::vector<std::vector<Region>> &region);
-    bool is_available_partial_solution(std::vector<std::vector<Region>> &region);
+    bool run_tier(std::vector<std::vector<Region>> &region, RuleTier tier, bool &changed);
+    void demote_rules(void);
+    bool rule_zero(std::vector<std::vector<Region>> &region, bool &changed);
+    bool rule_count(std::vector<std::vector<Region>> &region, bool &changed);
+    bool rule_checkerboard(std::vector<std::vector<Region>> &region, bool &changed);
+    bool rule_corner(std::vector<std::vector<Region>> &region, bool &changed);
+    bool rule_one_neighborhood(std::vector<std::vector<Region>> &region, bool &changed);
+    bool rule_one_one(std::vector<std::vector<Region>> &region, bool &changed);
+    bool rule_three_three(std::vector<std::vector<Region>> &region, bool &changed);
+    bool rule_diagonal(std::vector<std::vector<Region>> &region, bool &changed);
+    bool is_available_partial_solution(std::vector<std::vector<Region>> &region, bool &changed);
     bool is_answer(std::vector<std::vector<Region>> &region);
     std::pair<int, int> find_region(std::vector<std::vector<Region>> &region, Region val);
     void print_region(const std::vector<std::vector<Region>> &region);
@@ -44,6 +108,14 @@ private:
     const int nr, nc;
     std::vector<std::vector<Number>> grid;
     std::vector<std::vector<Region>> region_solved;
+    std::vector<RuleStat> rules;
+
+    SearchConfig config;
+    std::mt19937 rng;
+    long nodes = 0, node_limit = 0;
+    bool aborted = false;
+    const std::atomic<bool> *stop = nullptr;
+    UnsatCache *unsat_cache = nullptr;
 };
 
 }
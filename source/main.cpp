@@ -1,7 +1,44 @@
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include "slitherlink.hpp"
 
-int main(void) {
+/* Upper bound of K for -p. */
+static constexpr long max_workers = 1024;
+
+static void print_usage(const char *prog) {
+    std::cerr << "Usage: " << prog << " [-p K] [--no-share] < puzzle" << std::endl;
+    std::cerr << "  -p K        race K (0 to " << max_workers
+              << ") differently configured searches; K = 0 uses all hardware threads" << std::endl;
+    std::cerr << "  --no-share  do not share proven unsatisfiable states between searches" << std::endl;
+}
+
+int main(int argc, char **argv) {
+    int n_workers = -1;
+    bool share_unsat = true;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-p") == 0 && i + 1 < argc && n_workers < 0) {
+            char *end;
+            errno = 0;
+            long k = std::strtol(argv[++i], &end, 10);
+            if (end == argv[i] || *end != '\0' || errno != 0 || k < 0 || k > max_workers) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            n_workers = static_cast<int>(k);
+        } else if (std::strcmp(argv[i], "--no-share") == 0) {
+            share_unsat = false;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!share_unsat && n_workers < 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
     std::string s;
     std::vector<std::string> grid;
 
@@ -11,11 +48,11 @@ int main(void) {
 
     slink::Slitherlink sl(grid);
 
-    if (sl.solve()) {
+    if (n_workers >= 0 ? sl.solve_portfolio(n_workers, share_unsat) : sl.solve()) {
         sl.print_solution();
     } else {
         std::cout << "No solution" << std::endl;
     }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -1,7 +1,11 @@
 #include "slitherlink.hpp"
 
+#include <algorithm>
 #include <iostream>
+#include <mutex>
 #include <queue>
+#include <thread>
+#include <unordered_set>
 #include <utility>
 
 using namespace slink;
@@ -64,6 +68,20 @@ static constexpr int adjd[8][2] = {
     {-1, 0}, {-1, 1}, {0, 1}, {1, 1}, {1, 0}, {1, -1}, {0, -1}, {-1, -1},
 };
 
+/* Number of independently locked sets in the unsat cache. */
+static constexpr std::size_t unsat_cache_shards = 16;
+
+/* Proven unsatisfiable states shared between portfolio workers, keyed by their packed regions. */
+struct slink::UnsatCache {
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_set<std::string> states;
+        std::size_t bytes = 0;
+    };
+    Shard shards[unsat_cache_shards];
+};
+
+static long luby(long i);
 static Region inv_region(Region r);
 static bool is_same_region(Region r1, Region r2);
 static bool is_diff_region(Region r1, Region r2);
@@ -74,6 +92,7 @@ Slitherlink::Slitherlink(const std::vector<std::vector<int>> &grid)
     FOR_CELL {
         this->grid[i][j] = static_cast<Number>(grid[i - 1][j - 1]);
     }
+    this->init_rules();
 }
 
 Slitherlink::Slitherlink(const std::vector<std::string> &grid)
@@ -81,6 +100,7 @@ Slitherlink::Slitherlink(const std::vector<std::string> &grid)
     FOR_CELL {
         this->grid[i][j] = isdigit(grid[i - 1][j - 1]) ? static_cast<Number>(grid[i - 1][j - 1] - '0') : Number::EMPTY;
     }
+    this->init_rules();
 }
 
 bool Slitherlink::solve(void) {
@@ -92,7 +112,59 @@ bool Slitherlink::solve(void) {
         region[0][j] = region[this->nr + 1][j] = Region::OUTER;
     }
 
-    return this->solve_helper(region);
+    this->rng.seed(this->config.seed);
+    for (long run = 1;; ++run) {
+        this->nodes = 0;
+        this->node_limit = this->config.restart_base > 0 ? this->config.restart_base * luby(run) : 0;
+        this->aborted = false;
+        if (this->solve_helper(region)) {
+            return true;
+        }
+        /* The search space is exhausted or another worker asked to stop. */
+        if (!this->aborted || (this->stop != nullptr && this->stop->load())) {
+            return false;
+        }
+    }
+}
+
+bool Slitherlink::solve_portfolio(int n_workers, bool share_unsat) {
+    if (n_workers <= 0) {
+        n_workers = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    std::atomic<bool> stop(false);
+    UnsatCache cache;
+    std::mutex result_mutex;
+    int winner = -1;
+    bool result = false;
+
+    std::vector<Slitherlink> workers(n_workers, *this);
+    std::vector<std::thread> threads;
+    for (int k = 0; k < n_workers; ++k) {
+        workers[k].config = portfolio_config(k);
+        workers[k].stop = &stop;
+        workers[k].unsat_cache = share_unsat ? &cache : nullptr;
+        threads.emplace_back([&, k] {
+            bool solved = workers[k].solve();
+            /* A worker which was not stopped either found a solution or proved that there is none. */
+            if (solved || !workers[k].aborted) {
+                std::lock_guard<std::mutex> lock(result_mutex);
+                if (winner == -1) {
+                    winner = k;
+                    result = solved;
+                    stop = true;
+                }
+            }
+        });
+    }
+    for (std::thread &t : threads) {
+        t.join();
+    }
+
+    if (result) {
+        this->region_solved = workers[winner].region_solved;
+    }
+    return result;
 }
 
 void Slitherlink::print_solution(void) {
@@ -152,7 +224,34 @@ void Slitherlink::print_solution(void) {
     }
 }
 
+SearchConfig Slitherlink::portfolio_config(int idx) {
+    /* The first worker runs the default search, so the portfolio is never slower than it on enough cores. Randomized
+        restarting workers are interleaved early so that small portfolios cover every variation. */
+    static const SearchConfig configs[] = {
+        {VarOrder::FIRST, Polarity::OUTER_FIRST, 0, 0},
+        {VarOrder::MOST_DETERMINED, Polarity::RANDOM, 1, 64},
+        {VarOrder::FIRST, Polarity::INNER_FIRST, 0, 0},
+        {VarOrder::MOST_DETERMINED, Polarity::RANDOM, 3, 256},
+        {VarOrder::MOST_DETERMINED, Polarity::OUTER_FIRST, 0, 0},
+        {VarOrder::LAST, Polarity::INNER_FIRST, 0, 0},
+    };
+    constexpr int n_configs = sizeof(configs) / sizeof(configs[0]);
+
+    if (idx < n_configs) {
+        return configs[idx];
+    }
+    /* Further workers are randomized and restart so that they do not get stuck in the same subtree. */
+    return {VarOrder::MOST_DETERMINED, Polarity::RANDOM, static_cast<unsigned>(idx), idx % 2 == 0 ? 64 : 256};
+}
+
 bool Slitherlink::solve_helper(const std::vector<std::vector<Region>> &region) {
+    ++this->nodes;
+    if ((this->stop != nullptr && this->stop->load(std::memory_order_relaxed)) ||
+        (this->node_limit > 0 && this->nodes > this->node_limit)) {
+        this->aborted = true;
+        return false;
+    }
+
     std::vector<std::vector<Region>> new_region = region;
     if (!this->apply_heuristics(new_region)) {
         return false;
@@ -162,295 +261,486 @@ bool Slitherlink::solve_helper(const std::vector<std::vector<Region>> &region) {
         return true;
     }
 
-    /* Find the first undetermined region. */
-    auto [i0, j0] = this->find_region(new_region, Region::UNDET);
+    /* Skip the state if some worker already proved that it has no solution. */
+    std::string key;
+    std::size_t shard_idx = 0;
+    if (this->unsat_cache != nullptr) {
+        key = this->region_key(new_region);
+        shard_idx = std::hash<std::string>{}(key) % unsat_cache_shards;
+        UnsatCache::Shard &shard = this->unsat_cache->shards[shard_idx];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (shard.states.count(key) > 0) {
+            return false;
+        }
+    }
+
+    /* Find an undetermined region to branch on. */
+    auto [i0, j0] = this->pick_branch(new_region);
     /* No undetermined region. */
     if (i0 == -1 && j0 == -1) {
         return false;
     }
 
-    /* Try to fill the region with OUTER. */
-    new_region[i0][j0] = Region::OUTER;
+    /* Try to fill the region with both values, in the order given by the polarity. */
+    Region first = this->pick_polarity();
+    new_region[i0][j0] = first;
     if (this->solve_helper(new_region)) {
         return true;
     }
-    /* Try to fill the region with INNER. */
-    new_region[i0][j0] = Region::INNER;
+    if (this->aborted) {
+        return false;
+    }
+    new_region[i0][j0] = inv_region(first);
     if (this->solve_helper(new_region)) {
         return true;
     }
-    return false;
-}
-
-bool Slitherlink::apply_heuristics(std::vector<std::vector<Region>> &region) {
-    if (!this->is_available_partial_solution(region)) {
+    if (this->aborted) {
         return false;
     }
 
-    bool changed = true;
-    while (changed) {
-        changed = false;
+    if (this->unsat_cache != nullptr) {
+        /* Count the key, the string object and the hash node as the cost of an entry. */
+        std::size_t cost = key.size() + sizeof(std::string) + 2 * sizeof(void *);
+        UnsatCache::Shard &shard = this->unsat_cache->shards[shard_idx];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (shard.bytes + cost <= UNSAT_CACHE_MAX_BYTES / unsat_cache_shards &&
+            shard.states.insert(std::move(key)).second) {
+            shard.bytes += cost;
+        }
+    }
+    return false;
+}
 
-        FOR_CELL {
-            /* For 0, its adjacent cell must have the same region. */
-            if (this->grid[i][j] == Number::ZERO) {
-                FOR_ADJ {
-                    UPDATE_SAME(region[i][j], ADJ_REG);
+std::pair<int, int> Slitherlink::pick_branch(const std::vector<std::vector<Region>> &region) {
+    if (this->config.order == VarOrder::LAST) {
+        for (int i = this->nr; i > 0; --i) {
+            for (int j = this->nc; j > 0; --j) {
+                if (region[i][j] == Region::UNDET) {
+                    return std::make_pair(i, j);
                 }
             }
+        }
+        return std::make_pair(-1, -1);
+    }
 
-            if (this->grid[i][j] != Number::EMPTY && region[i][j] != Region::UNDET) {
-                /* For n > 0, if its region is determined and have n adjacent cells with the different region, then
-                    other adjacent regions must have the same region. */
-                int cnt = 0;
-                FOR_ADJ {
-                    if (is_diff_region(ADJ_REG, region[i][j])) {
-                        ++cnt;
-                    }
-                }
-                if (cnt == static_cast<int>(this->grid[i][j])) {
-                    FOR_ADJ {
-                        if (ADJ_REG == Region::UNDET) {
-                            UPDATE(ADJ_REG, region[i][j]);
-                        }
-                    }
-                } else if (cnt > static_cast<int>(this->grid[i][j])) {
-                    return false;
-                }
+    /* For MOST_DETERMINED, pick the undetermined region with the most determined adjacent regions. */
+    std::pair<int, int> best(-1, -1);
+    int best_score = -1, n_ties = 0;
+    FOR_CELL {
+        if (region[i][j] != Region::UNDET) {
+            continue;
+        }
+        if (this->config.order == VarOrder::FIRST) {
+            return std::make_pair(i, j);
+        }
 
-                /* For n > 0, if its region is determined and have 4 - n adjacent cells with the same region, then
-                    other adjacent regions must have the different region. */
-                cnt = 0;
-                FOR_ADJ {
-                    if (is_same_region(ADJ_REG, region[i][j])) {
-                        ++cnt;
-                    }
-                }
-                if (cnt == 4 - static_cast<int>(this->grid[i][j])) {
-                    FOR_ADJ {
-                        if (ADJ_REG == Region::UNDET) {
-                            UPDATE(ADJ_REG, inv_region(region[i][j]));
-                        }
-                    }
-                } else if (cnt > 4 - static_cast<int>(this->grid[i][j])) {
-                    return false;
-                }
+        int score = 0;
+        FOR_ADJ {
+            if (ADJ_REG != Region::UNDET) {
+                ++score;
             }
+        }
+        if (score > best_score) {
+            best = std::make_pair(i, j);
+            best_score = score;
+            n_ties = 1;
+        } else if (score == best_score && this->config.seed != 0 && this->rng() % ++n_ties == 0) {
+            best = std::make_pair(i, j);
+        }
+    }
+    return best;
+}
 
-            /* Avoid checkerboard pattern. */
-            if (is_diff_region(region[i][j], region[i + 1][j]) && is_diff_region(region[i][j], region[i][j + 1])) {
-                UPDATE_DIFF(region[i][j], region[i + 1][j + 1]);
-            }
-            if (is_diff_region(region[i][j + 1], region[i][j]) &&
-                is_diff_region(region[i][j + 1], region[i + 1][j + 1])) {
-                UPDATE_DIFF(region[i][j + 1], region[i + 1][j]);
-            }
-            if (is_diff_region(region[i + 1][j], region[i][j]) &&
-                is_diff_region(region[i + 1][j], region[i + 1][j + 1])) {
-                UPDATE_DIFF(region[i + 1][j], region[i][j + 1]);
-            }
-            if (is_diff_region(region[i + 1][j + 1], region[i][j + 1]) &&
-                is_diff_region(region[i + 1][j + 1], region[i + 1][j])) {
-                UPDATE_DIFF(region[i + 1][j + 1], region[i][j]);
-            }
+Region Slitherlink::pick_polarity(void) {
+    switch (this->config.polarity) {
+        case Polarity::INNER_FIRST:
+            return Region::INNER;
+        case Polarity::RANDOM:
+            return this->rng() % 2 == 0 ? Region::OUTER : Region::INNER;
+        default:
+            return Region::OUTER;
+    }
+}
 
-            if (this->grid[i][j] == Number::ONE) {
-                for (int k = 0; k < 8; k += 2) {
-                    if ((is_diff_region(ADJD_REG(k), ADJD_REG(k + 1)) &&
-                         is_same_region(ADJD_REG(k + 1), ADJD_REG(k + 2))) ||
-                        (is_same_region(ADJD_REG(k), ADJD_REG(k + 1)) &&
-                         is_diff_region(ADJD_REG(k + 1), ADJD_REG(k + 2)))) {
-                        UPDATE_SAME(region[i][j], ADJD_REG(k + 4));
-                        UPDATE_SAME(region[i][j], ADJD_REG(k + 6));
-                    }
+std::string Slitherlink::region_key(const std::vector<std::vector<Region>> &region) {
+    /* Pack the cells, which are UNDET, INNER or OUTER here, in 2 bits each. */
+    std::string key((this->nr * this->nc + 3) / 4, '\0');
+    int idx = 0;
+    FOR_CELL {
+        key[idx / 4] |= static_cast<char>(static_cast<int>(region[i][j]) << (2 * (idx % 4)));
+        ++idx;
+    }
+    return key;
+}
 
-                    if (is_diff_region(ADJD_REG(k), ADJD_REG(k + 1)) && is_same_region(region[i][j], ADJD_REG(k + 4)) &&
-                        is_same_region(region[i][j], ADJD_REG(k + 6))) {
-                        UPDATE_SAME(ADJD_REG(k + 1), ADJD_REG(k + 2));
-                    }
+void Slitherlink::init_rules(void) {
+    /* Local rules looking only at a cell and its adjacent cells are cheap. Rules matching patterns over the
+        8-neighborhood or pairs of clues are expensive and run only after the cheap ones stall. */
+    this->rules = {
+        {&Slitherlink::rule_zero, RuleTier::CHEAP, 0, 0},
+        {&Slitherlink::rule_count, RuleTier::CHEAP, 0, 0},
+        {&Slitherlink::rule_checkerboard, RuleTier::CHEAP, 0, 0},
+        {&Slitherlink::rule_corner, RuleTier::CHEAP, 0, 0},
+        {&Slitherlink::rule_one_neighborhood, RuleTier::EXPENSIVE, 0, 0},
+        {&Slitherlink::rule_one_one, RuleTier::EXPENSIVE, 0, 0},
+        {&Slitherlink::rule_three_three, RuleTier::EXPENSIVE, 0, 0},
+        {&Slitherlink::rule_diagonal, RuleTier::EXPENSIVE, 0, 0},
+    };
+}
 
-                    if (is_diff_region(ADJD_REG(k + 1), ADJD_REG(k + 2)) &&
-                        is_same_region(region[i][j], ADJD_REG(k + 4)) &&
-                        is_same_region(region[i][j], ADJD_REG(k + 6))) {
-                        UPDATE_SAME(ADJD_REG(k), ADJD_REG(k + 1));
-                    }
-                }
+bool Slitherlink::apply_heuristics(std::vector<std::vector<Region>> &region) {
+    bool changed = true;
+    while (changed) {
+        /* Run the cheap tier to a fixpoint. */
+        do {
+            changed = false;
+            if (!this->run_tier(region, RuleTier::CHEAP, changed)) {
+                return false;
             }
+        } while (changed);
 
-            if (this->grid[i][j] == Number::ONE && this->grid[i + 1][j + 1] == Number::ONE) {
-                if ((is_same_region(region[i][j], region[i + 1][j]) &&
-                     is_same_region(region[i][j], region[i][j + 1])) ||
-                    (is_same_region(region[i + 1][j + 1], region[i][j + 1]) &&
-                     is_same_region(region[i + 1][j + 1], region[i + 1][j]))) {
-                    UPDATE_SAME(region[i][j], region[i + 1][j + 1]);
-                }
+        /* The cheap tier stalled; try the expensive tier once and go back to the cheap tier if it made progress. */
+        if (!this->run_tier(region, RuleTier::EXPENSIVE, changed)) {
+            return false;
+        }
+        if (changed) {
+            continue;
+        }
 
-                if (is_same_region(region[i][j], region[i - 1][j]) && is_same_region(region[i][j], region[i][j - 1])) {
-                    UPDATE_SAME(region[i + 1][j + 1], region[i + 1][j + 2]);
-                    UPDATE_SAME(region[i + 1][j + 1], region[i + 2][j + 1]);
-                }
+        /* Both tiers stalled; check the global connectivity, which may also fill enclosed regions. */
+        if (!this->is_available_partial_solution(region, changed)) {
+            return false;
+        }
+    }
 
-                if (is_same_region(region[i + 1][j + 1], region[i + 1][j + 2]) &&
-                    is_same_region(region[i + 1][j + 1], region[i + 2][j + 1])) {
-                    UPDATE_SAME(region[i][j], region[i - 1][j]);
-                    UPDATE_SAME(region[i][j], region[i][j - 1]);
-                }
+    this->demote_rules();
+    return true;
+}
+
+bool Slitherlink::run_tier(std::vector<std::vector<Region>> &region, RuleTier tier, bool &changed) {
+    for (RuleStat &stat : this->rules) {
+        if (stat.tier != tier) {
+            continue;
+        }
+
+        bool fired = false;
+        ++stat.passes;
+        if (!(this->*stat.rule)(region, fired)) {
+            return false;
+        }
+        if (fired) {
+            ++stat.fires;
+            changed = true;
+        }
+    }
+    return true;
+}
+
+void Slitherlink::demote_rules(void) {
+    /* Move cheap rules which rarely make progress to the expensive tier. Only the schedule changes, so the deductions
+        reached are the same. */
+    for (RuleStat &stat : this->rules) {
+        if (stat.tier == RuleTier::CHEAP && stat.passes >= DEMOTE_MIN_PASSES &&
+            stat.fires * DEMOTE_FIRE_RATIO < stat.passes) {
+            stat.tier = RuleTier::EXPENSIVE;
+        }
+    }
+}
+
+bool Slitherlink::rule_zero(std::vector<std::vector<Region>> &region, bool &changed) {
+    /* For 0, its adjacent cell must have the same region. */
+    FOR_CELL {
+        if (this->grid[i][j] == Number::ZERO) {
+            FOR_ADJ {
+                UPDATE_SAME(region[i][j], ADJ_REG);
             }
+        }
+    }
+    return true;
+}
 
-            if (this->grid[i][j] == Number::ONE && this->grid[i + 1][j - 1] == Number::ONE) {
-                if ((is_same_region(region[i][j], region[i][j - 1]) &&
-                     is_same_region(region[i][j], region[i + 1][j])) ||
-                    (is_same_region(region[i + 1][j - 1], region[i + 1][j]) &&
-                     is_same_region(region[i + 1][j - 1], region[i][j - 1]))) {
-                    UPDATE_SAME(region[i][j], region[i + 1][j - 1]);
-                }
+bool Slitherlink::rule_count(std::vector<std::vector<Region>> &region, bool &changed) {
+    FOR_CELL {
+        if (this->grid[i][j] == Number::EMPTY || region[i][j] == Region::UNDET) {
+            continue;
+        }
 
-                if (is_same_region(region[i][j], region[i - 1][j]) && is_same_region(region[i][j], region[i][j + 1])) {
-                    UPDATE_SAME(region[i + 1][j - 1], region[i + 1][j - 2]);
-                    UPDATE_SAME(region[i + 1][j - 1], region[i + 2][j - 1]);
+        /* For n > 0, if its region is determined and have n adjacent cells with the different region, then other
+            adjacent regions must have the same region. */
+        int cnt = 0;
+        FOR_ADJ {
+            if (is_diff_region(ADJ_REG, region[i][j])) {
+                ++cnt;
+            }
+        }
+        if (cnt == static_cast<int>(this->grid[i][j])) {
+            FOR_ADJ {
+                if (ADJ_REG == Region::UNDET) {
+                    UPDATE(ADJ_REG, region[i][j]);
                 }
+            }
+        } else if (cnt > static_cast<int>(this->grid[i][j])) {
+            return false;
+        }
 
-                if (is_same_region(region[i + 1][j - 1], region[i + 1][j - 2]) &&
-                    is_same_region(region[i + 1][j - 1], region[i + 2][j - 1])) {
-                    UPDATE_SAME(region[i][j], region[i - 1][j]);
-                    UPDATE_SAME(region[i][j], region[i][j + 1]);
+        /* For n > 0, if its region is determined and have 4 - n adjacent cells with the same region, then other
+            adjacent regions must have the different region. */
+        cnt = 0;
+        FOR_ADJ {
+            if (is_same_region(ADJ_REG, region[i][j])) {
+                ++cnt;
+            }
+        }
+        if (cnt == 4 - static_cast<int>(this->grid[i][j])) {
+            FOR_ADJ {
+                if (ADJ_REG == Region::UNDET) {
+                    UPDATE(ADJ_REG, inv_region(region[i][j]));
                 }
             }
+        } else if (cnt > 4 - static_cast<int>(this->grid[i][j])) {
+            return false;
+        }
+    }
+    return true;
+}
 
-            /* When two 3's are adjacent. */
-            if (this->grid[i][j] == Number::THREE && this->grid[i][j + 1] == Number::THREE &&
-                (is_same_region(region[i][j - 1], region[i][j + 1]) || is_diff_region(region[i][j], region[i][j + 1]) ||
-                 is_same_region(region[i][j], region[i][j + 2]))) {
-                UPDATE_DIFF(region[i][j - 1], region[i][j]);
-                UPDATE_SAME(region[i][j - 1], region[i][j + 1]);
-                UPDATE_DIFF(region[i][j - 1], region[i][j + 2]);
+bool Slitherlink::rule_checkerboard(std::vector<std::vector<Region>> &region, bool &changed) {
+    /* Avoid checkerboard pattern. */
+    FOR_CELL {
+        if (is_diff_region(region[i][j], region[i + 1][j]) && is_diff_region(region[i][j], region[i][j + 1])) {
+            UPDATE_DIFF(region[i][j], region[i + 1][j + 1]);
+        }
+        if (is_diff_region(region[i][j + 1], region[i][j]) && is_diff_region(region[i][j + 1], region[i + 1][j + 1])) {
+            UPDATE_DIFF(region[i][j + 1], region[i + 1][j]);
+        }
+        if (is_diff_region(region[i + 1][j], region[i][j]) && is_diff_region(region[i + 1][j], region[i + 1][j + 1])) {
+            UPDATE_DIFF(region[i + 1][j], region[i][j + 1]);
+        }
+        if (is_diff_region(region[i + 1][j + 1], region[i][j + 1]) &&
+            is_diff_region(region[i + 1][j + 1], region[i + 1][j])) {
+            UPDATE_DIFF(region[i + 1][j + 1], region[i][j]);
+        }
+    }
+    return true;
+}
 
-                UPDATE_DIFF(region[i][j], region[i][j + 1]);
-                UPDATE_SAME(region[i][j], region[i][j + 2]);
+bool Slitherlink::rule_one_neighborhood(std::vector<std::vector<Region>> &region, bool &changed) {
+    FOR_CELL {
+        if (this->grid[i][j] != Number::ONE) {
+            continue;
+        }
 
-                UPDATE_DIFF(region[i][j + 1], region[i][j + 2]);
+        for (int k = 0; k < 8; k += 2) {
+            if ((is_diff_region(ADJD_REG(k), ADJD_REG(k + 1)) && is_same_region(ADJD_REG(k + 1), ADJD_REG(k + 2))) ||
+                (is_same_region(ADJD_REG(k), ADJD_REG(k + 1)) && is_diff_region(ADJD_REG(k + 1), ADJD_REG(k + 2)))) {
+                UPDATE_SAME(region[i][j], ADJD_REG(k + 4));
+                UPDATE_SAME(region[i][j], ADJD_REG(k + 6));
             }
-            if (this->grid[i][j] == Number::THREE && this->grid[i + 1][j] == Number::THREE &&
-                (is_same_region(region[i - 1][j], region[i + 1][j]) || is_diff_region(region[i][j], region[i + 1][j]) ||
-                 is_same_region(region[i][j], region[i + 2][j]))) {
-                UPDATE_DIFF(region[i - 1][j], region[i][j]);
-                UPDATE_SAME(region[i - 1][j], region[i + 1][j]);
-                UPDATE_DIFF(region[i - 1][j], region[i + 2][j]);
-
-                UPDATE_DIFF(region[i][j], region[i + 1][j]);
-                UPDATE_SAME(region[i][j], region[i + 2][j]);
 
-                UPDATE_DIFF(region[i + 1][j], region[i + 2][j]);
+            if (is_diff_region(ADJD_REG(k), ADJD_REG(k + 1)) && is_same_region(region[i][j], ADJD_REG(k + 4)) &&
+                is_same_region(region[i][j], ADJD_REG(k + 6))) {
+                UPDATE_SAME(ADJD_REG(k + 1), ADJD_REG(k + 2));
             }
 
-            /* When two 3's are diagonally adjacent. */
-            if (this->grid[i][j] == Number::THREE && this->grid[i + 1][j + 1] == Number::THREE) {
-                UPDATE_DIFF(region[i][j], region[i - 1][j]);
-                UPDATE_DIFF(region[i][j], region[i][j - 1]);
-                UPDATE_DIFF(region[i + 1][j + 1], region[i + 2][j + 1]);
-                UPDATE_DIFF(region[i + 1][j + 1], region[i + 1][j + 2]);
+            if (is_diff_region(ADJD_REG(k + 1), ADJD_REG(k + 2)) && is_same_region(region[i][j], ADJD_REG(k + 4)) &&
+                is_same_region(region[i][j], ADJD_REG(k + 6))) {
+                UPDATE_SAME(ADJD_REG(k), ADJD_REG(k + 1));
             }
-            if (this->grid[i][j] == Number::THREE && this->grid[i + 1][j - 1] == Number::THREE) {
-                UPDATE_DIFF(region[i][j], region[i - 1][j]);
-                UPDATE_DIFF(region[i][j], region[i][j + 1]);
-                UPDATE_DIFF(region[i + 1][j - 1], region[i + 2][j - 1]);
-                UPDATE_DIFF(region[i + 1][j - 1], region[i + 1][j - 2]);
+        }
+    }
+    return true;
+}
+
+bool Slitherlink::rule_one_one(std::vector<std::vector<Region>> &region, bool &changed) {
+    /* When two 1's are diagonally adjacent. */
+    FOR_CELL {
+        if (this->grid[i][j] == Number::ONE && this->grid[i + 1][j + 1] == Number::ONE) {
+            if ((is_same_region(region[i][j], region[i + 1][j]) && is_same_region(region[i][j], region[i][j + 1])) ||
+                (is_same_region(region[i + 1][j + 1], region[i][j + 1]) &&
+                 is_same_region(region[i + 1][j + 1], region[i + 1][j]))) {
+                UPDATE_SAME(region[i][j], region[i + 1][j + 1]);
             }
 
-            /* When two diagnoally adjacent cells with the same region have common neighbor with the same region and
-                the other common neighbor is 3, it must have the different region. */
-            if (this->grid[i][j] == Number::THREE) {
-                if (is_same_region(region[i - 1][j], region[i - 1][j + 1]) &&
-                    is_same_region(region[i - 1][j + 1], region[i][j + 1])) {
-                    UPDATE(region[i][j], inv_region(region[i - 1][j]));
-                }
-                if (is_same_region(region[i][j + 1], region[i + 1][j + 1]) &&
-                    is_same_region(region[i + 1][j + 1], region[i + 1][j])) {
-                    UPDATE(region[i][j], inv_region(region[i][j + 1]));
-                }
-                if (is_same_region(region[i + 1][j], region[i + 1][j - 1]) &&
-                    is_same_region(region[i + 1][j - 1], region[i][j - 1])) {
-                    UPDATE(region[i][j], inv_region(region[i + 1][j]));
-                }
-                if (is_same_region(region[i][j - 1], region[i - 1][j - 1]) &&
-                    is_same_region(region[i - 1][j - 1], region[i - 1][j])) {
-                    UPDATE(region[i][j], inv_region(region[i][j - 1]));
-                }
+            if (is_same_region(region[i][j], region[i - 1][j]) && is_same_region(region[i][j], region[i][j - 1])) {
+                UPDATE_SAME(region[i + 1][j + 1], region[i + 1][j + 2]);
+                UPDATE_SAME(region[i + 1][j + 1], region[i + 2][j + 1]);
             }
 
-            /* When two diagnoally adjacent cells with the same region have common neighbor with the same region and
-                the other common neighbor is 1, it must have the same region. */
-            if (this->grid[i][j] == Number::ONE) {
-                if (is_same_region(region[i - 1][j], region[i - 1][j + 1]) &&
-                    is_same_region(region[i - 1][j + 1], region[i][j + 1])) {
-                    UPDATE(region[i][j], region[i - 1][j]);
-                }
-                if (is_same_region(region[i][j + 1], region[i + 1][j + 1]) &&
-                    is_same_region(region[i + 1][j + 1], region[i + 1][j])) {
-                    UPDATE(region[i][j], region[i][j + 1]);
-                }
-                if (is_same_region(region[i + 1][j], region[i + 1][j - 1]) &&
-                    is_same_region(region[i + 1][j - 1], region[i][j - 1])) {
-                    UPDATE(region[i][j], region[i + 1][j]);
-                }
-                if (is_same_region(region[i][j - 1], region[i - 1][j - 1]) &&
-                    is_same_region(region[i - 1][j - 1], region[i - 1][j])) {
-                    UPDATE(region[i][j], region[i][j - 1]);
-                }
+            if (is_same_region(region[i + 1][j + 1], region[i + 1][j + 2]) &&
+                is_same_region(region[i + 1][j + 1], region[i + 2][j + 1])) {
+                UPDATE_SAME(region[i][j], region[i - 1][j]);
+                UPDATE_SAME(region[i][j], region[i][j - 1]);
             }
         }
 
-        /* If a 1 is in a corner, it must be in the outer region. */
-        if (this->grid[1][1] == Number::ONE) {
-            UPDATE(region[1][1], Region::OUTER);
-        }
-        if (this->grid[1][this->nc] == Number::ONE) {
-            UPDATE(region[1][this->nc], Region::OUTER);
-        }
-        if (this->grid[this->nr][1] == Number::ONE) {
-            UPDATE(region[this->nr][1], Region::OUTER);
-        }
-        if (this->grid[this->nr][this->nc] == Number::ONE) {
-            UPDATE(region[this->nr][this->nc], Region::OUTER);
-        }
+        if (this->grid[i][j] == Number::ONE && this->grid[i + 1][j - 1] == Number::ONE) {
+            if ((is_same_region(region[i][j], region[i][j - 1]) && is_same_region(region[i][j], region[i + 1][j])) ||
+                (is_same_region(region[i + 1][j - 1], region[i + 1][j]) &&
+                 is_same_region(region[i + 1][j - 1], region[i][j - 1]))) {
+                UPDATE_SAME(region[i][j], region[i + 1][j - 1]);
+            }
+
+            if (is_same_region(region[i][j], region[i - 1][j]) && is_same_region(region[i][j], region[i][j + 1])) {
+                UPDATE_SAME(region[i + 1][j - 1], region[i + 1][j - 2]);
+                UPDATE_SAME(region[i + 1][j - 1], region[i + 2][j - 1]);
+            }
 
-        /* If a 2 is in a corner, its two adjacent cells must be in the inner region. */
-        if (this->grid[1][1] == Number::TWO) {
-            UPDATE(region[1][2], Region::INNER);
-            UPDATE(region[2][1], Region::INNER);
+            if (is_same_region(region[i + 1][j - 1], region[i + 1][j - 2]) &&
+                is_same_region(region[i + 1][j - 1], region[i + 2][j - 1])) {
+                UPDATE_SAME(region[i][j], region[i - 1][j]);
+                UPDATE_SAME(region[i][j], region[i][j + 1]);
+            }
         }
-        if (this->grid[1][this->nc] == Number::TWO) {
-            UPDATE(region[1][this->nc - 1], Region::INNER);
-            UPDATE(region[2][this->nc], Region::INNER);
+    }
+    return true;
+}
+
+bool Slitherlink::rule_three_three(std::vector<std::vector<Region>> &region, bool &changed) {
+    FOR_CELL {
+        if (this->grid[i][j] != Number::THREE) {
+            continue;
         }
-        if (this->grid[this->nr][1] == Number::TWO) {
-            UPDATE(region[this->nr - 1][1], Region::INNER);
-            UPDATE(region[this->nr][2], Region::INNER);
+
+        /* When two 3's are adjacent. */
+        if (this->grid[i][j + 1] == Number::THREE &&
+            (is_same_region(region[i][j - 1], region[i][j + 1]) || is_diff_region(region[i][j], region[i][j + 1]) ||
+             is_same_region(region[i][j], region[i][j + 2]))) {
+            UPDATE_DIFF(region[i][j - 1], region[i][j]);
+            UPDATE_SAME(region[i][j - 1], region[i][j + 1]);
+            UPDATE_DIFF(region[i][j - 1], region[i][j + 2]);
+
+            UPDATE_DIFF(region[i][j], region[i][j + 1]);
+            UPDATE_SAME(region[i][j], region[i][j + 2]);
+
+            UPDATE_DIFF(region[i][j + 1], region[i][j + 2]);
         }
-        if (this->grid[this->nr][this->nc] == Number::TWO) {
-            UPDATE(region[this->nr][this->nc - 1], Region::INNER);
-            UPDATE(region[this->nr - 1][this->nc], Region::INNER);
+        if (this->grid[i + 1][j] == Number::THREE &&
+            (is_same_region(region[i - 1][j], region[i + 1][j]) || is_diff_region(region[i][j], region[i + 1][j]) ||
+             is_same_region(region[i][j], region[i + 2][j]))) {
+            UPDATE_DIFF(region[i - 1][j], region[i][j]);
+            UPDATE_SAME(region[i - 1][j], region[i + 1][j]);
+            UPDATE_DIFF(region[i - 1][j], region[i + 2][j]);
+
+            UPDATE_DIFF(region[i][j], region[i + 1][j]);
+            UPDATE_SAME(region[i][j], region[i + 2][j]);
+
+            UPDATE_DIFF(region[i + 1][j], region[i + 2][j]);
         }
 
-        /* If a 3 is in a corner, it must be in the inner region. */
-        if (this->grid[1][1] == Number::THREE) {
-            UPDATE(region[1][1], Region::INNER);
+        /* When two 3's are diagonally adjacent. */
+        if (this->grid[i + 1][j + 1] == Number::THREE) {
+            UPDATE_DIFF(region[i][j], region[i - 1][j]);
+            UPDATE_DIFF(region[i][j], region[i][j - 1]);
+            UPDATE_DIFF(region[i + 1][j + 1], region[i + 2][j + 1]);
+            UPDATE_DIFF(region[i + 1][j + 1], region[i + 1][j + 2]);
         }
-        if (this->grid[1][this->nc] == Number::THREE) {
-            UPDATE(region[1][this->nc], Region::INNER);
+        if (this->grid[i + 1][j - 1] == Number::THREE) {
+            UPDATE_DIFF(region[i][j], region[i - 1][j]);
+            UPDATE_DIFF(region[i][j], region[i][j + 1]);
+            UPDATE_DIFF(region[i + 1][j - 1], region[i + 2][j - 1]);
+            UPDATE_DIFF(region[i + 1][j - 1], region[i + 1][j - 2]);
         }
-        if (this->grid[this->nr][1] == Number::THREE) {
-            UPDATE(region[this->nr][1], Region::INNER);
+    }
+    return true;
+}
+
+bool Slitherlink::rule_diagonal(std::vector<std::vector<Region>> &region, bool &changed) {
+    FOR_CELL {
+        /* When two diagnoally adjacent cells with the same region have common neighbor with the same region and the
+            other common neighbor is 3, it must have the different region. */
+        if (this->grid[i][j] == Number::THREE) {
+            if (is_same_region(region[i - 1][j], region[i - 1][j + 1]) &&
+                is_same_region(region[i - 1][j + 1], region[i][j + 1])) {
+                UPDATE(region[i][j], inv_region(region[i - 1][j]));
+            }
+            if (is_same_region(region[i][j + 1], region[i + 1][j + 1]) &&
+                is_same_region(region[i + 1][j + 1], region[i + 1][j])) {
+                UPDATE(region[i][j], inv_region(region[i][j + 1]));
+            }
+            if (is_same_region(region[i + 1][j], region[i + 1][j - 1]) &&
+                is_same_region(region[i + 1][j - 1], region[i][j - 1])) {
+                UPDATE(region[i][j], inv_region(region[i + 1][j]));
+            }
+            if (is_same_region(region[i][j - 1], region[i - 1][j - 1]) &&
+                is_same_region(region[i - 1][j - 1], region[i - 1][j])) {
+                UPDATE(region[i][j], inv_region(region[i][j - 1]));
+            }
         }
-        if (this->grid[this->nr][this->nc] == Number::THREE) {
-            UPDATE(region[this->nr][this->nc], Region::INNER);
+
+        /* When two diagnoally adjacent cells with the same region have common neighbor with the same region and the
+            other common neighbor is 1, it must have the same region. */
+        if (this->grid[i][j] == Number::ONE) {
+            if (is_same_region(region[i - 1][j], region[i - 1][j + 1]) &&
+                is_same_region(region[i - 1][j + 1], region[i][j + 1])) {
+                UPDATE(region[i][j], region[i - 1][j]);
+            }
+            if (is_same_region(region[i][j + 1], region[i + 1][j + 1]) &&
+                is_same_region(region[i + 1][j + 1], region[i + 1][j])) {
+                UPDATE(region[i][j], region[i][j + 1]);
+            }
+            if (is_same_region(region[i + 1][j], region[i + 1][j - 1]) &&
+                is_same_region(region[i + 1][j - 1], region[i][j - 1])) {
+                UPDATE(region[i][j], region[i + 1][j]);
+            }
+            if (is_same_region(region[i][j - 1], region[i - 1][j - 1]) &&
+                is_same_region(region[i - 1][j - 1], region[i - 1][j])) {
+                UPDATE(region[i][j], region[i][j - 1]);
+            }
         }
     }
+    return true;
+}
 
+bool Slitherlink::rule_corner(std::vector<std::vector<Region>> &region, bool &changed) {
+    /* If a 1 is in a corner, it must be in the outer region. */
+    if (this->grid[1][1] == Number::ONE) {
+        UPDATE(region[1][1], Region::OUTER);
+    }
+    if (this->grid[1][this->nc] == Number::ONE) {
+        UPDATE(region[1][this->nc], Region::OUTER);
+    }
+    if (this->grid[this->nr][1] == Number::ONE) {
+        UPDATE(region[this->nr][1], Region::OUTER);
+    }
+    if (this->grid[this->nr][this->nc] == Number::ONE) {
+        UPDATE(region[this->nr][this->nc], Region::OUTER);
+    }
+
+    /* If a 2 is in a corner, its two adjacent cells must be in the inner region. */
+    if (this->grid[1][1] == Number::TWO) {
+        UPDATE(region[1][2], Region::INNER);
+        UPDATE(region[2][1], Region::INNER);
+    }
+    if (this->grid[1][this->nc] == Number::TWO) {
+        UPDATE(region[1][this->nc - 1], Region::INNER);
+        UPDATE(region[2][this->nc], Region::INNER);
+    }
+    if (this->grid[this->nr][1] == Number::TWO) {
+        UPDATE(region[this->nr - 1][1], Region::INNER);
+        UPDATE(region[this->nr][2], Region::INNER);
+    }
+    if (this->grid[this->nr][this->nc] == Number::TWO) {
+        UPDATE(region[this->nr][this->nc - 1], Region::INNER);
+        UPDATE(region[this->nr - 1][this->nc], Region::INNER);
+    }
+
+    /* If a 3 is in a corner, it must be in the inner region. */
+    if (this->grid[1][1] == Number::THREE) {
+        UPDATE(region[1][1], Region::INNER);
+    }
+    if (this->grid[1][this->nc] == Number::THREE) {
+        UPDATE(region[1][this->nc], Region::INNER);
+    }
+    if (this->grid[this->nr][1] == Number::THREE) {
+        UPDATE(region[this->nr][1], Region::INNER);
+    }
+    if (this->grid[this->nr][this->nc] == Number::THREE) {
+        UPDATE(region[this->nr][this->nc], Region::INNER);
+    }
     return true;
 }
 
-bool Slitherlink::is_available_partial_solution(std::vector<std::vector<Region>> &region) {
+bool Slitherlink::is_available_partial_solution(std::vector<std::vector<Region>> &region, bool &changed) {
     /* No checkerboard pattern is allowed in 2x2 cells. */
     FOR_CELL {
         if (is_diff_region(region[i][j], region[i][j + 1]) && is_diff_region(region[i][j + 1], region[i + 1][j + 1]) &&
@@ -485,6 +775,7 @@ bool Slitherlink::is_available_partial_solution(std::vector<std::vector<Region>>
                 no_hole = false;
             } else if (region[i][j] == Region::UNDET) {
                 region[i][j] = Region::INNER;
+                changed = true;
             } else if (region[i][j] == Region::UNDET_BFS) {
                 region[i][j] = Region::UNDET;
             } else if (region[i][j] == Region::OUTER_BFS) {
@@ -579,6 +870,18 @@ void Slitherlink::print_region(const std::vector<std::vector<Region>> &region) {
     }
 }
 
+/* The i-th element (1-indexed) of the Luby sequence 1, 1, 2, 1, 1, 2, 4, ... */
+static long luby(long i) {
+    for (int k = 1;; ++k) {
+        if (i == (1L << k) - 1) {
+            return 1L << (k - 1);
+        }
+        if (i < (1L << k) - 1) {
+            return luby(i - (1L << (k - 1)) + 1);
+        }
+    }
+}
+
 static Region inv_region(Region r) {
     return r == Region::UNDET ? Region::UNDET : (r == Region::INNER ? Region::OUTER : Region::INNER);
 }